@@ -12,16 +12,29 @@
 #include <SFML/System/Vector2.hpp>
 #include <SFML/Window/Keyboard.hpp>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdio>
 #include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
 #include <math.h>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 constexpr uint32_t windowWidth = 1600;
 constexpr uint32_t windowHeight = 900;
+constexpr int colonyCount = 8;
 
 static sf::Color hsv2rgb(double hue, double sat, double val);
 
@@ -42,6 +55,8 @@ struct Nest {
   sf::Vector2f position;
   std::vector<std::unique_ptr<Ant>> ants;
   int nest_size;
+  // Hue used to draw the ants of this colony.
+  float hue = 0;
 };
 
 struct FoodSource {
@@ -53,56 +68,453 @@ struct Obstacle {
   sf::FloatRect bounds;
 };
 
+/** \brief Pheromone levels for all colonies on a single grid.
+ *
+ *  Every colony owns two channels: home and food. The channels of a cell are
+ *  stored next to each other, so that evaporation, blurring and drawing
+ *  touch all colonies' values for a cell in the same cache lines rather than
+ *  striding through one full grid per channel.
+ *
+ *  Sensing pays for this: an ant reads a single channel per cell, so its scan
+ *  touches one cache line per cell once a cell holds 16 or more channels.
+ */
 struct PheromoneMap {
-  float values[windowWidth / 4][windowHeight / 4];
-
-  void evaporate(float percentage) {
-    for (int x = 0; x < windowWidth / 4; x++) {
-      for (int y = 0; y < windowHeight / 4; y++) {
-        auto &amount = values[x][y];
-        if (amount > 15) {
-          // Cap at 15
-          amount = 15;
-        }
+  static constexpr int width = windowWidth / 4;
+  static constexpr int height = windowHeight / 4;
+
+  int channels;
+  std::vector<float> values;
+
+  explicit PheromoneMap(int colonies = 1)
+      : channels(2 * colonies), values(width * height * channels) {}
+
+  // Follow if looking for home, deposit if coming from home.
+  static int homeChannel(int colony) { return 2 * colony; }
+  // Follow if looking for food, deposit if coming from food.
+  static int foodChannel(int colony) { return 2 * colony + 1; }
+
+  float *cell(int x, int y) { return &values[(x * height + y) * channels]; }
+  const float *cell(int x, int y) const {
+    return &values[(x * height + y) * channels];
+  }
+
+  float &at(int x, int y, int channel) { return cell(x, y)[channel]; }
+  float at(int x, int y, int channel) const { return cell(x, y)[channel]; }
+
+  // Sum of all pheromone per channel.
+  std::vector<double> mass() const {
+    std::vector<double> totals(channels);
+    for (int i = 0; i < width * height; i++) {
+      const float *amounts = &values[i * channels];
+      for (int c = 0; c < channels; c++) {
+        totals[c] += amounts[c];
+      }
+    }
+    return totals;
+  }
+
+  void evaporate(float homePercentage, float foodPercentage) {
+    for (int x = 0; x < width; x++) {
+      for (int y = 0; y < height; y++) {
+        float *amounts = cell(x, y);
+        for (int c = 0; c < channels; c++) {
+          auto &amount = amounts[c];
+          if (amount > 15) {
+            // Cap at 15
+            amount = 15;
+          }
 
-        amount *= (1.0f - percentage);
-        if (amount < 0.5f) {
-          amount = 0.0f;
+          amount *= (1.0f - (c % 2 == 0 ? homePercentage : foodPercentage));
+          if (amount < 0.5f) {
+            amount = 0.0f;
+          }
         }
       }
     }
   }
 
-  float blurKernel(int w, int h) {
+  float blurKernel(int w, int h, int c) {
     float middle = 0.5 + 0.125;
     float side = 0.125 * 0.5;
     float diag = 0.0625 * 0.5;
-    return middle * values[w][h] + side * values[w - 1][h] +
-           side * values[w + 1][h] + side * values[w][h - 1] +
-           side * values[w][h + 1] + diag * values[w - 1][h - 1] +
-           diag * values[w - 1][h + 1] + diag * values[w + 1][h - 1] +
-           diag * values[w + 1][h + 1];
+    return middle * at(w, h, c) + side * at(w - 1, h, c) +
+           side * at(w + 1, h, c) + side * at(w, h - 1, c) +
+           side * at(w, h + 1, c) + diag * at(w - 1, h - 1, c) +
+           diag * at(w - 1, h + 1, c) + diag * at(w + 1, h - 1, c) +
+           diag * at(w + 1, h + 1, c);
   }
 
   void blur() {
     // 3x3 gaussian blur
-    for (int x = 1; x < windowWidth / 4 - 1; x++) {
-      for (int y = 1; y < windowHeight / 4 - 1; y++) {
-        values[x][y] = blurKernel(x, y);
+    for (int x = 1; x < width - 1; x++) {
+      for (int y = 1; y < height - 1; y++) {
+        for (int c = 0; c < channels; c++) {
+          at(x, y, c) = blurKernel(x, y, c);
+        }
+      }
+    }
+  }
+};
+
+/** \brief Monotonically increasing metric.
+ *  \note  Written by the simulation loop and read by the MetricsExporter
+ *         thread. Relaxed atomics suffice, the loop never blocks on a lock.
+ */
+struct Counter {
+  std::atomic<uint64_t> value{0};
+
+  void add(uint64_t amount = 1) {
+    value.fetch_add(amount, std::memory_order_relaxed);
+  }
+  uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/** \brief Metric that is overwritten with the latest sample. */
+struct Gauge {
+  std::atomic<double> value{0};
+
+  void set(double sample) { value.store(sample, std::memory_order_relaxed); }
+  double get() const { return value.load(std::memory_order_relaxed); }
+};
+
+/** \brief Latency distribution with fixed buckets, in microseconds. */
+struct Histogram {
+  // Upper bounds of the buckets, the last bucket catches everything else.
+  // Finer between 1 and 10 ms, where a frame's work is expected to land.
+  static constexpr std::array<uint64_t, 19> bounds = {
+      50,   100,  250,  500,   1000,  1500,  2000,   2500,  3000,  4000,
+      5000, 6000, 7000, 8000, 10000, 25000, 50000, 100000, 250000};
+  using Snapshot = std::array<uint64_t, bounds.size() + 1>;
+
+  std::array<std::atomic<uint64_t>, bounds.size() + 1> buckets{};
+  std::atomic<uint64_t> sum{0};
+
+  void observe(uint64_t micros) {
+    size_t i = 0;
+    while (i < bounds.size() && micros > bounds[i]) {
+      i++;
+    }
+    buckets[i].fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(micros, std::memory_order_relaxed);
+  }
+
+  Snapshot snapshot() const {
+    Snapshot counts;
+    for (size_t i = 0; i < counts.size(); i++) {
+      counts[i] = buckets[i].load(std::memory_order_relaxed);
+    }
+    return counts;
+  }
+};
+
+using MetricsClock = std::chrono::steady_clock;
+
+static uint64_t microsecondsSince(MetricsClock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             MetricsClock::now() - start)
+      .count();
+}
+
+/** \brief Foraging metrics, updated every simulation step. */
+struct Metrics {
+  // Per colony.
+  std::vector<Counter> antsReturned;
+  // Per food source.
+  std::vector<Counter> foodPickedUp;
+  std::vector<Gauge> foodAmountLeft;
+  // Per pheromone channel, sampled after every evaporation.
+  std::vector<Gauge> pheromoneMass;
+  // State distribution over all colonies.
+  Gauge antsSearching;
+  Gauge antsReturning;
+  // Ants of either state that are currently confused.
+  Gauge antsConfused;
+  // Times an ant ran into an obstacle or the edge of the map.
+  Counter confusionEvents;
+
+  // Work done in a simulation step, excluding display and its frame limit.
+  Histogram tickDuration;
+  Histogram pheromonePhase;
+  Histogram pheromoneDrawPhase;
+  Histogram antPhase;
+  Histogram displayPhase;
+
+  Metrics(int colonies, int foodSources)
+      : antsReturned(colonies), foodPickedUp(foodSources),
+        foodAmountLeft(foodSources), pheromoneMass(2 * colonies) {}
+};
+
+/** \brief Periodically writes Metrics to disk on a background thread.
+ *
+ *  Produces a Prometheus text-format file, replaced atomically on every
+ *  flush, and a CSV file with one row per flush. The CSV is rotated to
+ *  `<csvPath>.1` once it holds `maxCsvRows` rows. Failing to write either
+ *  file is reported once on std::cerr.
+ */
+struct MetricsExporter {
+  const Metrics &metrics;
+  std::string prometheusPath;
+  std::string csvPath;
+  std::chrono::milliseconds interval;
+  int maxCsvRows;
+
+  std::ofstream csv;
+  int csvRows = 0;
+  uint64_t lastAntsReturned = 0;
+  Histogram::Snapshot lastTicks{};
+  uint64_t lastTickSum = 0;
+  MetricsClock::time_point lastFlush = MetricsClock::now();
+  bool prometheusFailed = false;
+  bool csvFailed = false;
+
+  std::mutex mutex;
+  std::condition_variable wakeup;
+  bool stopping = false;
+  std::thread thread;
+
+  MetricsExporter(const Metrics &metrics, std::string prometheusPath,
+                  std::string csvPath, std::chrono::milliseconds interval,
+                  int maxCsvRows = 10000)
+      : metrics(metrics), prometheusPath(std::move(prometheusPath)),
+        csvPath(std::move(csvPath)), interval(interval),
+        maxCsvRows(maxCsvRows) {
+    rotateCsv();
+    thread = std::thread([this] { run(); });
+  }
+
+  ~MetricsExporter() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeup.notify_one();
+    thread.join();
+  }
+
+  void run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+      wakeup.wait_for(lock, interval, [this] { return stopping; });
+      // Flush one last time when stopping, so the tail of a run is kept.
+      writePrometheus();
+      appendCsv();
+    }
+  }
+
+  void rotateCsv() {
+    csv.close();
+    std::string backup = csvPath + ".1";
+    std::remove(backup.c_str());
+    std::rename(csvPath.c_str(), backup.c_str());
+    csv.open(csvPath);
+    csv << std::setprecision(std::numeric_limits<double>::max_digits10);
+    csv << "unix_time,ants_returned,ants_returned_per_second,food_picked_up,"
+           "ants_searching,ants_returning,ants_confused,confusion_events,"
+           "pheromone_mass,ticks,tick_mean_us,tick_p99_us\n";
+    csvRows = 0;
+  }
+
+  static void reportFailure(bool &reported, const std::string &path) {
+    if (!reported) {
+      reported = true;
+      std::cerr << "Failed to write metrics to " << path << "\n";
+    }
+  }
+
+  // Writes a duration in microseconds as exact seconds.
+  static void writeSeconds(std::ostream &out, uint64_t micros) {
+    char fill = out.fill('0');
+    out << micros / 1000000 << "." << std::setw(6) << micros % 1000000;
+    out.fill(fill);
+  }
+
+  static void writeHistogram(std::ostream &out, const std::string &name,
+                             const std::string &labels,
+                             const Histogram &histogram) {
+    auto counts = histogram.snapshot();
+    std::string prefix = labels.empty() ? "{" : "{" + labels + ",";
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < Histogram::bounds.size(); i++) {
+      cumulative += counts[i];
+      out << name << "_bucket" << prefix << "le=\"";
+      writeSeconds(out, Histogram::bounds[i]);
+      out << "\"} " << cumulative << "\n";
+    }
+    cumulative += counts.back();
+    out << name << "_bucket" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+    std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+    out << name << "_sum" << suffix << " ";
+    writeSeconds(out, histogram.sum.load(std::memory_order_relaxed));
+    out << "\n";
+    out << name << "_count" << suffix << " " << cumulative << "\n";
+  }
+
+  void writePrometheus() {
+    std::string tmpPath = prometheusPath + ".tmp";
+    {
+      std::ofstream out(tmpPath);
+      if (!out) {
+        reportFailure(prometheusFailed, tmpPath);
+        return;
       }
+      out << std::setprecision(std::numeric_limits<double>::max_digits10);
+      out << "# HELP ant_academy_ants_returned_total Ants that brought food "
+             "back to their nest.\n"
+          << "# TYPE ant_academy_ants_returned_total counter\n";
+      for (size_t i = 0; i < metrics.antsReturned.size(); i++) {
+        out << "ant_academy_ants_returned_total{colony=\"" << i << "\"} "
+            << metrics.antsReturned[i].get() << "\n";
+      }
+
+      out << "# HELP ant_academy_food_picked_up_total Food taken from a "
+             "source.\n"
+          << "# TYPE ant_academy_food_picked_up_total counter\n";
+      for (size_t i = 0; i < metrics.foodPickedUp.size(); i++) {
+        out << "ant_academy_food_picked_up_total{source=\"" << i << "\"} "
+            << metrics.foodPickedUp[i].get() << "\n";
+      }
+
+      out << "# HELP ant_academy_food_amount_left Food left at a source.\n"
+          << "# TYPE ant_academy_food_amount_left gauge\n";
+      for (size_t i = 0; i < metrics.foodAmountLeft.size(); i++) {
+        out << "ant_academy_food_amount_left{source=\"" << i << "\"} "
+            << metrics.foodAmountLeft[i].get() << "\n";
+      }
+
+      out << "# HELP ant_academy_ants Ants per state.\n"
+          << "# TYPE ant_academy_ants gauge\n"
+          << "ant_academy_ants{state=\"searching\"} "
+          << metrics.antsSearching.get() << "\n"
+          << "ant_academy_ants{state=\"returning\"} "
+          << metrics.antsReturning.get() << "\n";
+
+      out << "# HELP ant_academy_ants_confused Ants that are confused, "
+             "regardless of their state.\n"
+          << "# TYPE ant_academy_ants_confused gauge\n"
+          << "ant_academy_ants_confused " << metrics.antsConfused.get()
+          << "\n";
+
+      out << "# HELP ant_academy_confusion_events_total Collisions with "
+             "obstacles or the edge of the map.\n"
+          << "# TYPE ant_academy_confusion_events_total counter\n"
+          << "ant_academy_confusion_events_total "
+          << metrics.confusionEvents.get() << "\n";
+
+      out << "# HELP ant_academy_pheromone_mass Total pheromone on a map.\n"
+          << "# TYPE ant_academy_pheromone_mass gauge\n";
+      for (size_t i = 0; i < metrics.pheromoneMass.size(); i++) {
+        out << "ant_academy_pheromone_mass{colony=\"" << i / 2
+            << "\",map=\"" << (i % 2 == 0 ? "home" : "food") << "\"} "
+            << metrics.pheromoneMass[i].get() << "\n";
+      }
+
+      out << "# HELP ant_academy_tick_duration_seconds Duration of a "
+             "simulation step, excluding display and the frame limit.\n"
+          << "# TYPE ant_academy_tick_duration_seconds histogram\n";
+      writeHistogram(out, "ant_academy_tick_duration_seconds", "",
+                     metrics.tickDuration);
+
+      out << "# HELP ant_academy_phase_duration_seconds Duration of a phase "
+             "of a simulation step.\n"
+          << "# TYPE ant_academy_phase_duration_seconds histogram\n";
+      writeHistogram(out, "ant_academy_phase_duration_seconds",
+                     "phase=\"pheromones\"", metrics.pheromonePhase);
+      writeHistogram(out, "ant_academy_phase_duration_seconds",
+                     "phase=\"draw_pheromones\"", metrics.pheromoneDrawPhase);
+      writeHistogram(out, "ant_academy_phase_duration_seconds",
+                     "phase=\"ants\"", metrics.antPhase);
+      writeHistogram(out, "ant_academy_phase_duration_seconds",
+                     "phase=\"display\"", metrics.displayPhase);
+      out.close();
+      if (!out) {
+        reportFailure(prometheusFailed, tmpPath);
+        return;
+      }
+    }
+    // Replace atomically, so scrapers never see a partial file.
+    if (std::rename(tmpPath.c_str(), prometheusPath.c_str()) != 0) {
+      reportFailure(prometheusFailed, prometheusPath);
     }
   }
+
+  void appendCsv() {
+    if (csvRows >= maxCsvRows) {
+      rotateCsv();
+    }
+    if (!csv) {
+      reportFailure(csvFailed, csvPath);
+      return;
+    }
+
+    auto now = MetricsClock::now();
+    double elapsed = std::chrono::duration<double>(now - lastFlush).count();
+    lastFlush = now;
+
+    uint64_t antsReturned = 0;
+    for (auto &counter : metrics.antsReturned) {
+      antsReturned += counter.get();
+    }
+    uint64_t foodPickedUp = 0;
+    for (auto &counter : metrics.foodPickedUp) {
+      foodPickedUp += counter.get();
+    }
+    double pheromoneMass = 0;
+    for (auto &gauge : metrics.pheromoneMass) {
+      pheromoneMass += gauge.get();
+    }
+
+    // Tick latency over this interval only.
+    auto ticks = metrics.tickDuration.snapshot();
+    uint64_t tickSum = metrics.tickDuration.sum.load(std::memory_order_relaxed);
+    Histogram::Snapshot delta;
+    uint64_t tickCount = 0;
+    for (size_t i = 0; i < ticks.size(); i++) {
+      delta[i] = ticks[i] - lastTicks[i];
+      tickCount += delta[i];
+    }
+    double tickMean =
+        tickCount > 0 ? double(tickSum - lastTickSum) / tickCount : 0;
+    // Upper bound of the bucket holding the 99th percentile.
+    double tickP99 = 0;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < delta.size() && tickCount > 0; i++) {
+      seen += delta[i];
+      if (seen * 100 >= tickCount * 99) {
+        tickP99 = i < Histogram::bounds.size() ? Histogram::bounds[i]
+                                               : INFINITY;
+        break;
+      }
+    }
+    lastTicks = ticks;
+    lastTickSum = tickSum;
+
+    uint64_t unixTime = std::chrono::duration_cast<std::chrono::seconds>(
+                            std::chrono::system_clock::now().time_since_epoch())
+                            .count();
+    csv << unixTime << "," << antsReturned << ","
+        << (elapsed > 0 ? (antsReturned - lastAntsReturned) / elapsed : 0)
+        << "," << foodPickedUp << "," << metrics.antsSearching.get() << ","
+        << metrics.antsReturning.get() << "," << metrics.antsConfused.get()
+        << "," << metrics.confusionEvents.get() << "," << pheromoneMass << ","
+        << tickCount << "," << tickMean << "," << tickP99 << "\n";
+    csv.flush();
+    if (!csv) {
+      reportFailure(csvFailed, csvPath);
+    }
+    csvRows++;
+    lastAntsReturned = antsReturned;
+  }
 };
 
 struct Environment {
-  Nest nest;
+  // One nest per colony. Colonies compete for the same food sources.
+  std::vector<Nest> nests;
   std::vector<FoodSource> food_sources;
   std::vector<Obstacle> obstacles;
-  // Follow if looking for home, deposit if coming from home.
-  PheromoneMap homePheromone;
-  // Follow if looking for food, deposit if coming from food.
-  PheromoneMap foodPheromone;
-  int antsReturned = 0;
+  // Home and food channels for every colony, see PheromoneMap.
+  PheromoneMap pheromones;
+  // Optional, updated when set.
+  Metrics *metrics = nullptr;
 };
 
 std::ostream &operator<<(std::ostream &out, sf::Vector2f const &v) {
@@ -116,6 +528,7 @@ struct Ant {
   float rotation = 0;
   int stepCounter = 0;
   sf::Vector2f nestPosition;
+  int colony;
   float hue;
   int pheromoneAvailable = 2000;
   int confusion = 0;
@@ -126,10 +539,10 @@ struct Ant {
   } state;
 
   Ant(sf::Vector2f position, float velocity, float rotation, int stepCounter,
-      sf::Vector2f nestPosition, float hue, State state)
+      sf::Vector2f nestPosition, int colony, float hue, State state)
       : position(position), velocity(velocity), rotation(rotation),
-        stepCounter(stepCounter), nestPosition(nestPosition), hue(hue),
-        state(state) {}
+        stepCounter(stepCounter), nestPosition(nestPosition), colony(colony),
+        hue(hue), state(state) {}
 
   void randomAdjustVelocity() {
     if (std::rand() % 5 == 0) {
@@ -147,7 +560,8 @@ struct Ant {
     }
   }
 
-  void rotateTowardsPheromone(const PheromoneMap &pheromones, int chance) {
+  void rotateTowardsPheromone(const PheromoneMap &pheromones, int channel,
+                              int chance) {
     int gridX = (int)floor(position.x / 4);
     int gridY = (int)floor(position.y / 4);
     // Look around for pheromones
@@ -163,8 +577,8 @@ struct Ant {
 
         auto absX = gridX + x;
         auto absY = gridY + y;
-        if (absX >= 0 && absX < windowWidth / 4 && absY >= 0 &&
-            absY < windowHeight / 4) {
+        if (absX >= 0 && absX < PheromoneMap::width && absY >= 0 &&
+            absY < PheromoneMap::height) {
           // Create unit vector from x and y
           sf::Vector2f unit(x, y);
           unit = normalize(unit);
@@ -179,7 +593,7 @@ struct Ant {
           unit *= inner_size;
 
           // Multiply vector with peromone level
-          float pheromone_level = pheromones.values[absX][absY];
+          float pheromone_level = pheromones.at(absX, absY, channel);
           unit *= pheromone_level;
 
           // Add vector to pheromoneSum
@@ -207,7 +621,7 @@ struct Ant {
   }
    */
 
-  void depositPheromone(PheromoneMap &pheromones) {
+  void depositPheromone(PheromoneMap &pheromones, int channel) {
     int gridX = (int)floor(position.x / 4);
     int gridY = (int)floor(position.y / 4);
 
@@ -217,9 +631,9 @@ struct Ant {
 
     // Deposit pheromones at the current position.
     auto amount = (pheromoneAvailable * 0.0005) + 0.01;
-    if (gridX >= 0 && gridX < windowWidth / 4 && gridY >= 0 &&
-        gridY < windowHeight / 4) {
-      pheromones.values[gridX][gridY] += amount;
+    if (gridX >= 0 && gridX < PheromoneMap::width && gridY >= 0 &&
+        gridY < PheromoneMap::height) {
+      pheromones.at(gridX, gridY, channel) += amount;
       pheromoneAvailable -= amount;
     }
   }
@@ -233,14 +647,20 @@ struct Ant {
     // HACK: Always have pheromone
     // pheromoneAvailable = 4000;
 
+    Nest &nest = environment.nests[colony];
+    hue = nest.hue;
+
     if (state == State::SEARCHING) {
-      hue = 100;
       // If position is very near food source and there is food available,
       // return.
-      for (auto &food : environment.food_sources) {
+      for (size_t i = 0; i < environment.food_sources.size(); i++) {
+        auto &food = environment.food_sources[i];
         auto foodDistance = length(food.position - position);
         if (foodDistance < 80.0 && food.amount_left > 0) {
           food.amount_left--;
+          if (environment.metrics) {
+            environment.metrics->foodPickedUp[i].add();
+          }
           state = State::RETURNING;
           pheromoneAvailable = 2000;
           rotation += 180;
@@ -251,28 +671,33 @@ struct Ant {
       randomAdjustRotation();
 
       if (confusion == 0) {
-        rotateTowardsPheromone(environment.foodPheromone, 4);
-        depositPheromone(environment.homePheromone);
+        rotateTowardsPheromone(environment.pheromones,
+                               PheromoneMap::foodChannel(colony), 4);
+        depositPheromone(environment.pheromones,
+                         PheromoneMap::homeChannel(colony));
       }
     }
     // Move in a straight line to the base
     else if (state == State::RETURNING) {
-      hue = 0;
       // If position is very near home, start searching.
-      auto nest_dist = length(environment.nest.position - position);
+      auto nest_dist = length(nest.position - position);
       if (nest_dist < 80.0) {
         state = State::SEARCHING;
         pheromoneAvailable = 2000;
         rotation += 180;
-        environment.antsReturned++;
+        if (environment.metrics) {
+          environment.metrics->antsReturned[colony].add();
+        }
       }
 
       randomAdjustVelocity();
       randomAdjustRotation();
       if (confusion == 0) {
-        rotateTowardsPheromone(environment.homePheromone, 4);
+        rotateTowardsPheromone(environment.pheromones,
+                               PheromoneMap::homeChannel(colony), 4);
         // rotateTowardsNest(environment, 400);
-        depositPheromone(environment.foodPheromone);
+        depositPheromone(environment.pheromones,
+                         PheromoneMap::foodChannel(colony));
       }
     }
 
@@ -308,6 +733,9 @@ struct Ant {
       // Not allowed to move here.
       rotation += 90;
       confusion = std::min(confusion + 100, 500);
+      if (environment.metrics) {
+        environment.metrics->confusionEvents.add();
+      }
     } else {
       if (confusion > 0) {
         confusion--;
@@ -329,7 +757,9 @@ struct Ant {
     antSprite.setTextureRect(sf::IntRect(left, top, 202, 248));
     antSprite.setPosition(position);
     antSprite.setRotation(rotation);
-    antSprite.setColor(hsv2rgb(hue, 1, 120));
+    // Hue identifies the colony, returning ants are drawn washed out.
+    antSprite.setColor(
+        hsv2rgb(hue, state == State::RETURNING ? 0.4 : 1, 120));
     window.draw(antSprite);
   }
 };
@@ -389,8 +819,8 @@ struct ControllableAnt : public Ant {
 
           auto absX = gridX + x;
           auto absY = gridY + y;
-          if (absX >= 0 && absX < windowWidth / 4 && absY >= 0 &&
-              absY < windowHeight / 4) {
+          if (absX >= 0 && absX < PheromoneMap::width && absY >= 0 &&
+              absY < PheromoneMap::height) {
             // Create unit vector from x and y
             sf::Vector2f unit(x, y);
             unit = normalize(unit);
@@ -406,8 +836,8 @@ struct ControllableAnt : public Ant {
             unit *= inner_size;
 
             // Multiply vector with peromone level
-            float pheromone_level =
-                environment.homePheromone.values[absX][absY];
+            float pheromone_level = environment.pheromones.at(
+                absX, absY, PheromoneMap::homeChannel(colony));
             unit *= pheromone_level;
 
             // Add vector to pheromoneSum
@@ -456,10 +886,17 @@ int main() {
   holeSprite.setScale(2.0, 2.0);
   holeSprite.setOrigin(40, 40);
 
-  Environment environment{.nest{
-                              .position = sf::Vector2f(600, 400),
-                              .nest_size = 100,
-                          },
+  // Place the nests on a ring around the middle of the map, clear of the
+  // obstacle below it.
+  std::vector<Nest> nests(colonyCount);
+  for (int i = 0; i < colonyCount; i++) {
+    float angle = 360.0f * i / colonyCount;
+    nests[i].position = sf::Vector2f(800, 350) + vectorOf(angle) * 220.f;
+    nests[i].nest_size = 100;
+    nests[i].hue = angle;
+  }
+
+  Environment environment{.nests = std::move(nests),
                           .food_sources = {
                               FoodSource{
                                   .position = sf::Vector2f(1200, 800),
@@ -477,20 +914,24 @@ int main() {
                                   .position = sf::Vector2f(1200, 100),
                                   .amount_left = 0,
                               },
-                          }};
+                          },
+                          .pheromones = PheromoneMap(colonyCount)};
   environment.obstacles.push_back(Obstacle{
       .bounds = sf::FloatRect(400, 600, 800, 50),
   });
 
-  holeSprite.setPosition(environment.nest.position);
-
   sf::Sprite foodSprite;
   foodSprite.setTexture(terrainTexture);
   foodSprite.setTextureRect(sf::IntRect(256, 544, 32, 24));
   foodSprite.setScale(3.0, 3.0);
   foodSprite.setOrigin(18, 16);
 
-  sf::Clock simulationStartClock;
+  Metrics metrics(colonyCount, environment.food_sources.size());
+  environment.metrics = &metrics;
+  // Declared after the metrics, so it stops before they are destroyed.
+  MetricsExporter exporter(metrics, "ant-academy.prom", "ant-academy.csv",
+                           std::chrono::seconds(5));
+
   sf::Clock antSpawnClock;
   sf::Clock blurClock;
   sf::Clock foodSupplyClock;
@@ -499,6 +940,7 @@ int main() {
                                          (windowHeight / 4) * 6);
 
   while (window.isOpen()) {
+    auto tickStart = MetricsClock::now();
     for (auto event = sf::Event{}; window.pollEvent(event);) {
       if (event.type == sf::Event::Closed) {
         window.close();
@@ -520,7 +962,10 @@ int main() {
       }
     }
 
-    window.draw(holeSprite);
+    for (auto &nest : environment.nests) {
+      holeSprite.setPosition(nest.position);
+      window.draw(holeSprite);
+    }
 
     for (auto &food : environment.food_sources) {
       foodSprite.setPosition(food.position);
@@ -529,11 +974,17 @@ int main() {
 
     if (blurClock.getElapsedTime().asMilliseconds() > 1000) {
       blurClock.restart();
+      auto phaseStart = MetricsClock::now();
       // Evaporate & draw pheromones.
-      environment.homePheromone.evaporate(0.05);
-      environment.foodPheromone.evaporate(0.03);
-      environment.homePheromone.blur();
-      environment.foodPheromone.blur();
+      environment.pheromones.evaporate(0.05, 0.03);
+      environment.pheromones.blur();
+      metrics.pheromonePhase.observe(microsecondsSince(phaseStart));
+
+      // Sampled here rather than every step, it needs a pass over the map.
+      auto mass = environment.pheromones.mass();
+      for (size_t c = 0; c < mass.size(); c++) {
+        metrics.pheromoneMass[c].set(mass[c]);
+      }
     }
 
     if (foodSupplyClock.getElapsedTime().asSeconds() > 30) {
@@ -542,11 +993,18 @@ int main() {
         environment.food_sources[source_to_supply].amount_left += 10 + std::rand() % 30;
     }
 
+    auto drawStart = MetricsClock::now();
     int vidx = 0;
-    for (int x = 0; x < windowWidth / 4; x++) {
-      for (int y = 0; y < windowHeight / 4; y++) {
-        auto homeAmount = environment.homePheromone.values[x][y];
-        auto foodAmount = environment.foodPheromone.values[x][y];
+    for (int x = 0; x < PheromoneMap::width; x++) {
+      for (int y = 0; y < PheromoneMap::height; y++) {
+        // Draw the combined trails of all colonies.
+        const float *amounts = environment.pheromones.cell(x, y);
+        float homeAmount = 0.0f;
+        float foodAmount = 0.0f;
+        for (int colony = 0; colony < colonyCount; colony++) {
+          homeAmount += amounts[PheromoneMap::homeChannel(colony)];
+          foodAmount += amounts[PheromoneMap::foodChannel(colony)];
+        }
         if (foodAmount > 0.0f || homeAmount > 0.0f) {
           sf::Vertex *triangles = &pheromoneTiles[vidx];
           triangles[0].position = sf::Vector2f(x * 4, y * 4);
@@ -581,15 +1039,19 @@ int main() {
     }
 
     window.draw(pheromoneTiles.data(), vidx, sf::PrimitiveType::Triangles);
+    metrics.pheromoneDrawPhase.observe(microsecondsSince(drawStart));
 
-    Nest &nest = environment.nest;
-    if (nest.ants.size() < nest.nest_size &&
-        antSpawnClock.getElapsedTime().asSeconds() > 0.5) {
-      // Add a new ant.
+    if (antSpawnClock.getElapsedTime().asSeconds() > 0.5) {
+      // Add a new ant to every colony that is not full yet.
       antSpawnClock.restart();
-      nest.ants.push_back(std::make_unique<Ant>(
-          nest.position, 0, float(std::rand() % 360), std::rand() % 63,
-          nest.position, float(std::rand() % 360), Ant::State::SEARCHING));
+      for (int colony = 0; colony < colonyCount; colony++) {
+        Nest &nest = environment.nests[colony];
+        if (nest.ants.size() < nest.nest_size) {
+          nest.ants.push_back(std::make_unique<Ant>(
+              nest.position, 0, float(std::rand() % 360), std::rand() % 63,
+              nest.position, colony, nest.hue, Ant::State::SEARCHING));
+        }
+      }
     }
 
     // Obstacles
@@ -601,29 +1063,41 @@ int main() {
       window.draw(obstacleShape);
     }
 
-    for (auto &ant : nest.ants) {
-      ant->update(environment);
-
-      ant->animateStep();
-      ant->draw(window, antSprite);
+    auto antStart = MetricsClock::now();
+    int searching = 0;
+    int returning = 0;
+    int confused = 0;
+    for (auto &nest : environment.nests) {
+      for (auto &ant : nest.ants) {
+        ant->update(environment);
+
+        ant->animateStep();
+        ant->draw(window, antSprite);
+
+        if (ant->state == Ant::State::SEARCHING) {
+          searching++;
+        } else {
+          returning++;
+        }
+        if (ant->confusion > 0) {
+          confused++;
+        }
+      }
+    }
+    metrics.antPhase.observe(microsecondsSince(antStart));
+    metrics.antsSearching.set(searching);
+    metrics.antsReturning.set(returning);
+    metrics.antsConfused.set(confused);
+    for (size_t i = 0; i < environment.food_sources.size(); i++) {
+      metrics.foodAmountLeft[i].set(environment.food_sources[i].amount_left);
     }
 
-    window.display();
+    // The frame limit sleeps in display, keep it out of the step's work.
+    metrics.tickDuration.observe(microsecondsSince(tickStart));
 
-    if (simulationStartClock.getElapsedTime().asSeconds() > 5.0) {
-      /*
-      std::cout << "Ants returned per second: "
-                << (environment.antsReturned /
-                    simulationStartClock.getElapsedTime().asSeconds())
-                << "\n";
-      */
-      for (auto foodsource : environment.food_sources) {
-        std::cout << "Amount left: " << foodsource.amount_left << "\n";
-      }
-
-      simulationStartClock.restart();
-      environment.antsReturned = 0;
-    }
+    auto displayStart = MetricsClock::now();
+    window.display();
+    metrics.displayPhase.observe(microsecondsSince(displayStart));
   }
 }
 